@@ -0,0 +1,442 @@
+#ifndef BIT_PARALLEL_MATCHER_H
+#define BIT_PARALLEL_MATCHER_H
+
+#include "small_bitset.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * bit-parallel approximate string matching for patterns of up to max_pattern_length characters
+ * both matchers keep one bit per pattern character, stored in registers, and precompute a mask per text character
+ * every text character updates the state in place with a single pass over the registers,
+ * the shift by one (with the carry from the previous register) is fused with the and/or of the update
+ *
+ * matches are reported through a callback as on_match(end) / on_match(end, distance),
+ * end being the index one past the last matched character, counted over all text passed since reset()
+ * the empty pattern matches after every character with distance 0
+ */
+
+namespace sb {
+/// Shift-And, extended to k errors (Wu-Manber): state level d has bit i set
+/// iff the first i + 1 pattern characters match a suffix of the text read so far with at most d errors
+template<std::size_t max_pattern_length>
+class shift_and_matcher {
+    static_assert(max_pattern_length > 0, "pattern length has to be greater than zero");
+
+    constexpr static std::size_t REGISTER_BITS = sizeof(std::size_t) * 8;
+    constexpr static std::size_t WORDS = (max_pattern_length + REGISTER_BITS - 1) / REGISTER_BITS;
+
+private:
+    std::size_t masks_[256][WORDS]{};
+    std::size_t length_;
+    std::size_t words_;
+    std::size_t max_errors_;
+    std::size_t last_bit_;
+    std::size_t active_ = 0; // registers from this one on are zero on every level
+    std::size_t position_ = 0;
+    std::vector<std::size_t> state_;     // word w of level d at state_[d * words_ + w]
+    std::vector<std::size_t> carries_;   // bits shifted out of the previous register while scanning, two per level
+
+public:
+    shift_and_matcher(char const *pattern, std::size_t length, std::size_t max_errors = 0)
+        : length_{length}, words_{(length + REGISTER_BITS - 1) / REGISTER_BITS}, max_errors_{max_errors},
+          last_bit_{length ? static_cast<std::size_t>(1) << ((length - 1) % REGISTER_BITS) : 0},
+          state_(words_ * (max_errors + 1)), carries_(2 * (max_errors + 1)) {
+        assert(length <= max_pattern_length && "pattern does not fit in matcher");
+        for (std::size_t i = 0; i < length; ++i)
+            masks_[static_cast<unsigned char>(pattern[i])][i / REGISTER_BITS] |= static_cast<std::size_t>(1) << (i % REGISTER_BITS);
+        reset();
+    }
+
+    explicit shift_and_matcher(std::string const &pattern, std::size_t max_errors = 0)
+        : shift_and_matcher(pattern.data(), pattern.size(), max_errors) {}
+
+    std::size_t pattern_length() const {
+        return length_;
+    }
+
+    std::size_t max_errors() const {
+        return max_errors_;
+    }
+
+    /// bit i is set iff the first i + 1 pattern characters match the end of the text with at most the given number of errors
+    small_bitset<max_pattern_length> active_prefixes(std::size_t errors = 0) const {
+        assert(errors <= max_errors_ && "no state is kept for that many errors");
+        small_bitset<max_pattern_length> result{};
+        for (std::size_t i = 0; i < length_; ++i)
+            result.set(i, (state_[errors * words_ + i / REGISTER_BITS] >> (i % REGISTER_BITS)) & 1);
+        return result;
+    }
+
+    /// forgets all text read so far
+    void reset() {
+        std::fill(state_.begin(), state_.end(), 0);
+        // with d errors the first d pattern characters can always be deleted
+        for (std::size_t d = 0; d <= max_errors_; ++d)
+            for (std::size_t i = 0; i < std::min(d, length_); ++i)
+                state_[d * words_ + i / REGISTER_BITS] |= static_cast<std::size_t>(1) << (i % REGISTER_BITS);
+        active_ = std::min(words_, std::min(max_errors_, length_) / REGISTER_BITS + 1);
+        position_ = 0;
+    }
+
+    /// reads one text character, returns whether a match ends with it
+    bool step(unsigned char c) {
+        bool matched = false;
+        char text = static_cast<char>(c);
+        scan(&text, 1, [&matched](std::size_t) { matched = true; });
+        return matched;
+    }
+
+    template<class F>
+    void scan(char const *text, std::size_t length, F &&on_match) {
+        if (length_ == 0) {
+            // the empty pattern has no state to update, it ends at every position
+            for (std::size_t i = 0; i < length; ++i)
+                on_match(position_ + i + 1);
+        } else if (max_errors_ == 0) {
+            _scan_exact(text, length, on_match);
+        } else {
+            _scan_errors(text, length, on_match);
+        }
+        position_ += length;
+    }
+
+    template<class F>
+    void scan(std::string const &text, F &&on_match) {
+        scan(text.data(), text.size(), on_match);
+    }
+
+private:
+    /// scan() without errors, there is only level 0 so no old values have to be kept for a level above
+    template<class F>
+    void _scan_exact(char const *text, std::size_t length, F &&on_match) {
+        std::size_t *state = state_.data();
+        std::size_t last_bit = last_bit_;
+        std::size_t position = position_;
+        if (words_ == 1) {
+            // the whole state fits in one register, keep it out of memory
+            std::size_t current = state[0];
+            for (std::size_t i = 0; i < length; ++i) {
+                current = ((current << 1) | 1) & masks_[static_cast<unsigned char>(text[i])][0];
+                if (current & last_bit)
+                    on_match(position + i + 1);
+            }
+            state[0] = current;
+            return;
+        }
+
+        // register 0 is always active and kept in a local, the others are only touched while they are non-zero
+        std::size_t words = words_;
+        std::size_t active = active_;
+        std::size_t first = state[0];
+        for (std::size_t i = 0; i < length; ++i) {
+            std::size_t const *mask = masks_[static_cast<unsigned char>(text[i])];
+            std::size_t carry = first >> (REGISTER_BITS - 1);
+            first = ((first << 1) | 1) & mask[0];
+            for (std::size_t w = 1; w < active; ++w) {
+                std::size_t old = state[w];
+                state[w] = ((old << 1) | carry) & mask[w];
+                carry = old >> (REGISTER_BITS - 1);
+            }
+            // the register above the active ones only becomes non-zero through the carry out of them
+            if (carry && active < words) {
+                state[active] = mask[active] & 1;
+                active += state[active] != 0;
+            }
+            while (active > 1 && !state[active - 1])
+                --active;
+            if (state[words - 1] & last_bit)
+                on_match(position + i + 1);
+        }
+        state[0] = first;
+        active_ = active;
+    }
+
+    /// scan() with errors, a register is updated on all levels before moving on to the next one so the new
+    /// and old value of the level below stay in locals, only the carries between registers go through memory
+    template<class F>
+    void _scan_errors(char const *text, std::size_t length, F &&on_match) {
+        std::size_t *state = state_.data();
+        std::size_t *shift_carry = carries_.data();
+        std::size_t *skip_carry = shift_carry + max_errors_ + 1;
+        std::size_t words = words_;
+        std::size_t max_errors = max_errors_;
+        std::size_t last_bit = last_bit_;
+        std::size_t position = position_;
+        std::size_t active = active_;
+        std::size_t const *top = state + max_errors * words;
+        // a bit reaches the next register within one character only if the highest level has one in the top
+        // max_errors + 1 positions, the levels are nested so checking the highest one is enough
+        std::size_t grow_bits = max_errors + 1 < REGISTER_BITS ? ~static_cast<std::size_t>(0) << (REGISTER_BITS - 1 - max_errors) : ~static_cast<std::size_t>(0);
+        for (std::size_t i = 0; i < length; ++i) {
+            std::size_t const *mask = masks_[static_cast<unsigned char>(text[i])];
+            if (active < words && (top[active - 1] & grow_bits))
+                ++active;
+
+            // register 0 gets ones shifted in at the bottom of every level
+            std::size_t *level = state;
+            std::size_t below_old = *level;
+            std::size_t below_new = ((below_old << 1) | 1) & mask[0];
+            *level = below_new;
+            if (active == 1) {
+                for (std::size_t d = 1; d <= max_errors; ++d) {
+                    level += words;
+                    std::size_t old = *level;
+                    below_new = _update(old, below_old, below_new, mask[0], 1, 1);
+                    *level = below_new;
+                    below_old = old;
+                }
+            } else {
+                shift_carry[0] = below_old >> (REGISTER_BITS - 1);
+                for (std::size_t d = 1; d <= max_errors; ++d) {
+                    level += words;
+                    std::size_t old = *level;
+                    shift_carry[d] = old >> (REGISTER_BITS - 1);
+                    skip_carry[d] = (below_old | below_new) >> (REGISTER_BITS - 1);
+                    below_new = _update(old, below_old, below_new, mask[0], 1, 1);
+                    *level = below_new;
+                    below_old = old;
+                }
+                for (std::size_t w = 1; w < active; ++w) {
+                    level = state + w;
+                    below_old = *level;
+                    below_new = ((below_old << 1) | shift_carry[0]) & mask[w];
+                    shift_carry[0] = below_old >> (REGISTER_BITS - 1);
+                    *level = below_new;
+                    for (std::size_t d = 1; d <= max_errors; ++d) {
+                        level += words;
+                        std::size_t old = *level;
+                        std::size_t skip = (below_old | below_new) >> (REGISTER_BITS - 1);
+                        below_new = _update(old, below_old, below_new, mask[w], shift_carry[d], skip_carry[d]);
+                        shift_carry[d] = old >> (REGISTER_BITS - 1);
+                        skip_carry[d] = skip;
+                        *level = below_new;
+                        below_old = old;
+                    }
+                }
+            }
+
+            // the highest level has the most bits set, if it is zero so are the others
+            while (active > 1 && !top[active - 1])
+                --active;
+            if (top[words - 1] & last_bit)
+                on_match(position + i + 1);
+        }
+        active_ = active;
+    }
+
+    /// new value of a register on a level with errors from its old value and the old and new value of the level below
+    static std::size_t _update(std::size_t old, std::size_t below_old, std::size_t below_new, std::size_t mask, std::size_t shift_carry, std::size_t skip_carry) {
+        // match | insertion | substitution and deletion
+        return ((((old << 1) | shift_carry) & mask) | below_old | skip_carry) | ((below_old | below_new) << 1);
+    }
+};
+
+/// Myers' bit-vector algorithm in its multi-register form: keeps the vertical deltas of the
+/// edit distance matrix column, so besides the matches it also reports their edit distance
+/// only the registers which can still contain a cell of at most max_errors() are updated (Ukkonen's cut-off)
+template<std::size_t max_pattern_length>
+class myers_matcher {
+    static_assert(max_pattern_length > 0, "pattern length has to be greater than zero");
+
+    constexpr static std::size_t REGISTER_BITS = sizeof(std::size_t) * 8;
+    constexpr static std::size_t WORDS = (max_pattern_length + REGISTER_BITS - 1) / REGISTER_BITS;
+    constexpr static std::size_t HIGH_BIT = static_cast<std::size_t>(1) << (REGISTER_BITS - 1);
+
+private:
+    std::size_t peq_[256][WORDS]{};
+    std::size_t positive_[WORDS]{};  // vertical deltas of +1
+    std::size_t negative_[WORDS]{};  // vertical deltas of -1
+    std::ptrdiff_t scores_[WORDS]{}; // value of the last row of each register
+    std::size_t length_;
+    std::size_t words_;
+    std::size_t max_errors_;
+    std::size_t last_bit_;
+    std::size_t last_ = 0; // last register which is kept up to date
+    std::size_t position_ = 0;
+
+public:
+    myers_matcher(char const *pattern, std::size_t length, std::size_t max_errors = 0)
+        : length_{length}, words_{(length + REGISTER_BITS - 1) / REGISTER_BITS}, max_errors_{max_errors},
+          last_bit_{length ? static_cast<std::size_t>(1) << ((length - 1) % REGISTER_BITS) : 0} {
+        assert(length <= max_pattern_length && "pattern does not fit in matcher");
+        for (std::size_t i = 0; i < length; ++i)
+            peq_[static_cast<unsigned char>(pattern[i])][i / REGISTER_BITS] |= static_cast<std::size_t>(1) << (i % REGISTER_BITS);
+        reset();
+    }
+
+    explicit myers_matcher(std::string const &pattern, std::size_t max_errors = 0)
+        : myers_matcher(pattern.data(), pattern.size(), max_errors) {}
+
+    std::size_t pattern_length() const {
+        return length_;
+    }
+
+    std::size_t max_errors() const {
+        return max_errors_;
+    }
+
+    /// edit distance between the pattern and the best substring ending at the last character read
+    /// exact if it is at most max_errors(), otherwise some value greater than max_errors()
+    std::size_t distance() const {
+        if (last_ + 1 < words_) return max_errors_ + 1;
+        return static_cast<std::size_t>(scores_[last_]);
+    }
+
+    /// forgets all text read so far
+    void reset() {
+        // the empty pattern has no registers, register 0 then keeps its score of 0 for distance()
+        last_ = words_ ? std::min(words_ - 1, max_errors_ / REGISTER_BITS) : 0;
+        for (std::size_t w = 0; w <= last_; ++w) {
+            positive_[w] = static_cast<std::size_t>(-1);
+            negative_[w] = 0;
+            scores_[w] = static_cast<std::ptrdiff_t>(_last_row(w));
+        }
+        position_ = 0;
+    }
+
+    /// reads one text character, returns whether a match with at most max_errors() errors ends with it
+    bool step(unsigned char c) {
+        bool matched = false;
+        char text = static_cast<char>(c);
+        scan(&text, 1, [&matched](std::size_t, std::size_t) { matched = true; });
+        return matched;
+    }
+
+    template<class F>
+    void scan(char const *text, std::size_t length, F &&on_match) {
+        std::ptrdiff_t max_errors = static_cast<std::ptrdiff_t>(max_errors_);
+        std::size_t last_bit = last_bit_;
+        std::size_t position = position_;
+        position_ += length;
+        if (words_ == 0) {
+            // the empty pattern ends at every position without errors
+            for (std::size_t i = 0; i < length; ++i)
+                on_match(position + i + 1, static_cast<std::size_t>(0));
+            return;
+        }
+        if (words_ == 1) {
+            // the whole column fits in one register, keep it out of memory
+            std::size_t pv = positive_[0];
+            std::size_t mv = negative_[0];
+            std::ptrdiff_t score = scores_[0];
+            for (std::size_t i = 0; i < length; ++i) {
+                score += _advance(pv, mv, peq_[static_cast<unsigned char>(text[i])][0], 0, last_bit);
+                if (score <= max_errors)
+                    on_match(position + i + 1, static_cast<std::size_t>(score));
+            }
+            positive_[0] = pv;
+            negative_[0] = mv;
+            scores_[0] = score;
+            return;
+        }
+
+        std::size_t *positive = positive_;
+        std::size_t *negative = negative_;
+        std::ptrdiff_t *scores = scores_;
+        std::size_t words = words_;
+        std::size_t last = last_;
+        for (std::size_t i = 0; i < length; ++i) {
+            std::size_t const *eq_column = peq_[static_cast<unsigned char>(text[i])];
+            // horizontal delta entering the current register from above, the top row of the matrix is all zero
+            int carry = 0;
+            for (std::size_t w = 0; w <= last; ++w) {
+                carry = _advance(positive[w], negative[w], eq_column[w], carry, w + 1 == words ? last_bit : HIGH_BIT);
+                scores[w] += carry;
+            }
+
+            // WORDS is checked as well so the compiler sees there is no register below in single register matchers
+            if (last + 1 < WORDS && last + 1 < words && scores[last] - carry <= max_errors && ((eq_column[last + 1] & 1) || carry < 0)) {
+                // the register below can get a cell of at most max_errors(), its previous column is taken as
+                // increasing by one per row, which is all that matters for cells that were above max_errors()
+                ++last;
+                positive[last] = static_cast<std::size_t>(-1);
+                negative[last] = 0;
+                std::ptrdiff_t above = scores[last - 1] - carry + static_cast<std::ptrdiff_t>(_last_row(last) - _last_row(last - 1));
+                scores[last] = above + _advance(positive[last], negative[last], eq_column[last], carry, last + 1 == words ? last_bit : HIGH_BIT);
+            } else {
+                // a register ending in at least max_errors() + REGISTER_BITS only has cells above max_errors()
+                while (WORDS > 1 && last > 0 && scores[last] >= max_errors + static_cast<std::ptrdiff_t>(REGISTER_BITS))
+                    --last;
+            }
+            if (last + 1 == words && scores[last] <= max_errors)
+                on_match(position + i + 1, static_cast<std::size_t>(scores[last]));
+        }
+        last_ = last;
+    }
+
+    template<class F>
+    void scan(std::string const &text, F &&on_match) {
+        scan(text.data(), text.size(), on_match);
+    }
+
+private:
+    /// number of pattern rows up to and including register w
+    std::size_t _last_row(std::size_t w) const {
+        return std::min((w + 1) * REGISTER_BITS, length_);
+    }
+
+    /// updates one register for the next text character, carry is the horizontal delta of the row above it
+    /// returns the horizontal delta of the row marked by high
+    static int _advance(std::size_t &pv, std::size_t &mv, std::size_t eq, int carry, std::size_t high) {
+        // the deltas change from character to character, so they are folded in without branches
+        std::size_t negative_in = carry < 0;
+        std::size_t xv = eq | mv;
+        eq |= negative_in;
+        std::size_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        std::size_t ph = mv | ~(xh | pv);
+        std::size_t mh = pv & xh;
+        // ph and mh never share a bit
+        int out = static_cast<int>((ph & high) != 0) - static_cast<int>((mh & high) != 0);
+
+        ph = (ph << 1) | static_cast<std::size_t>(carry > 0);
+        mh = (mh << 1) | negative_in;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        return out;
+    }
+};
+
+/// runs several matchers over the same text, the text is processed in blocks that stay in L1
+/// while every matcher goes over them, so each character is only read from memory once
+/// on_match is called as on_match(matcher index, match arguments...),
+/// matches are ordered by matcher within a block but not across matchers
+template<class Matcher, class F>
+void scan_batch(std::vector<Matcher> &matchers, char const *text, std::size_t length, F &&on_match) {
+    constexpr std::size_t BLOCK_BYTES = 16 * 1024;
+    for (std::size_t first = 0; first < length; first += BLOCK_BYTES) {
+        std::size_t n = std::min(BLOCK_BYTES, length - first);
+        for (std::size_t i = 0; i < matchers.size(); ++i)
+            matchers[i].scan(text + first, n, [&on_match, i](auto... match) { on_match(i, match...); });
+    }
+}
+
+template<class Matcher, class F>
+void scan_batch(std::vector<Matcher> &matchers, std::string const &text, F &&on_match) {
+    scan_batch(matchers, text.data(), text.size(), on_match);
+}
+
+#if __cplusplus < 201703L
+template<std::size_t max_pattern_length>
+constexpr std::size_t shift_and_matcher<max_pattern_length>::REGISTER_BITS;
+
+template<std::size_t max_pattern_length>
+constexpr std::size_t shift_and_matcher<max_pattern_length>::WORDS;
+
+template<std::size_t max_pattern_length>
+constexpr std::size_t myers_matcher<max_pattern_length>::REGISTER_BITS;
+
+template<std::size_t max_pattern_length>
+constexpr std::size_t myers_matcher<max_pattern_length>::WORDS;
+
+template<std::size_t max_pattern_length>
+constexpr std::size_t myers_matcher<max_pattern_length>::HIGH_BIT;
+#endif
+
+} // namespace sb
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef RING_SMALL_BITSET_H
+#define RING_SMALL_BITSET_H
+
+#include "small_bitset.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace sb {
+/// small_bitset used as a circular buffer, meant for sliding windows ("last num_bits events")
+/// logical bit 0 is stored at physical bit head_, so advance() and the rotations only move head_
+/// instead of physically shifting every byte
+/// all indices taken and returned are logical
+template<std::size_t num_bits>
+class ring_small_bitset {
+public:
+    using bitset_type = small_bitset<num_bits>;
+
+private:
+    bitset_type bits_{};
+    std::size_t head_ = 0; // physical index of logical bit 0
+
+public:
+    ring_small_bitset() = default;
+
+    explicit ring_small_bitset(bitset_type const &bits) : bits_{bits} {}
+
+    /// the same bits with logical bit 0 at physical bit 0
+    bitset_type to_bitset() const {
+        if (head_ == 0) return bits_;
+        return (bits_ >> head_) | (bits_ << (num_bits - head_));
+    }
+
+    bool operator==(ring_small_bitset const &other) const {
+        return to_bitset() == other.to_bitset();
+    }
+
+    bool operator!=(ring_small_bitset const &other) const {
+        return !(*this == other);
+    }
+
+    bool operator[](std::size_t idx) const {
+        return bits_.test(_physical(idx));
+    }
+
+    bool test(std::size_t idx) const {
+        return bits_.test(_physical(idx));
+    }
+
+    ring_small_bitset &set(std::size_t idx) {
+        bits_.set(_physical(idx));
+        return *this;
+    }
+
+    ring_small_bitset &reset(std::size_t idx) {
+        bits_.reset(_physical(idx));
+        return *this;
+    }
+
+    ring_small_bitset &set(std::size_t idx, bool value) {
+        bits_.set(_physical(idx), value);
+        return *this;
+    }
+
+    ring_small_bitset &set() {
+        bits_.set();
+        return *this;
+    }
+
+    ring_small_bitset &reset() {
+        bits_.reset();
+        return *this;
+    }
+
+    ring_small_bitset &flip() {
+        bits_.flip();
+        return *this;
+    }
+
+    bool all() const {
+        return bits_.all();
+    }
+
+    bool any() const {
+        return bits_.any();
+    }
+
+    bool none() const {
+        return bits_.none();
+    }
+
+    std::size_t count() const {
+        return bits_.count();
+    }
+
+    constexpr std::size_t size() const {
+        return num_bits;
+    }
+
+    /// same result as <<= amount on a small_bitset, but only the amount recycled bits are written
+    ring_small_bitset &advance(std::size_t amount) {
+        if (amount >= num_bits) {
+            bits_.reset();
+            head_ = 0;
+            return *this;
+        }
+        head_ = head_ >= amount ? head_ - amount : head_ + num_bits - amount;
+        if (head_ + amount <= num_bits) {
+            _clear_physical(head_, amount);
+        } else {
+            _clear_physical(head_, num_bits - head_);
+            _clear_physical(0, head_ + amount - num_bits);
+        }
+        return *this;
+    }
+
+    /// advance(1) followed by set(0, value)
+    ring_small_bitset &push(bool value) {
+        advance(1);
+        bits_.set(head_, value);
+        return *this;
+    }
+
+    /// bit idx moves to (idx + amount) % size()
+    ring_small_bitset &rotate_left(std::size_t amount) {
+        amount %= num_bits;
+        head_ = head_ >= amount ? head_ - amount : head_ + num_bits - amount;
+        return *this;
+    }
+
+    /// bit idx moves to (idx - amount) % size()
+    ring_small_bitset &rotate_right(std::size_t amount) {
+        amount %= num_bits;
+        head_ = head_ + amount < num_bits ? head_ + amount : head_ + amount - num_bits;
+        return *this;
+    }
+
+    /// index of the lowest set bit, size() if no bit is set
+    std::size_t find_first() const {
+        return _find_from(0);
+    }
+
+    /// index of the lowest set bit after prev, size() if there is none
+    std::size_t find_next(std::size_t prev) const {
+        if (prev + 1 >= num_bits) return num_bits;
+        return _find_from(prev + 1);
+    }
+
+    std::string to_string() const {
+        return to_bitset().to_string();
+    }
+
+private:
+    std::size_t _physical(std::size_t idx) const {
+        return head_ + idx < num_bits ? head_ + idx : head_ + idx - num_bits;
+    }
+
+    std::size_t _logical(std::size_t physical) const {
+        return physical >= head_ ? physical - head_ : physical + num_bits - head_;
+    }
+
+    /// lowest set physical bit at or after from
+    std::size_t _find_physical(std::size_t from) const {
+        return from == 0 ? bits_.find_first() : bits_.find_next(from - 1);
+    }
+
+    std::size_t _find_from(std::size_t idx) const {
+        std::size_t from = _physical(idx);
+        std::size_t found = _find_physical(from);
+        if (from >= head_) {
+            // logical range [idx, size()) wraps around the end of the storage
+            if (found < num_bits) return _logical(found);
+            found = bits_.find_first();
+        }
+        return found < head_ ? _logical(found) : num_bits;
+    }
+
+    void _clear_physical(std::size_t first, std::size_t count) {
+        if (!count) return;
+        std::size_t last = first + count - 1;
+        // callers keep last < num_bits, the compiler cannot see that through head_, so the byte indices are clamped
+        std::size_t first_byte = std::min(first / 8, bitset_type::STORAGE_BYTES - 1);
+        std::size_t last_byte = std::min(last / 8, bitset_type::STORAGE_BYTES - 1);
+        std::uint8_t first_mask = static_cast<std::uint8_t>(0xFF << (first % 8));
+        std::uint8_t last_mask = static_cast<std::uint8_t>(0xFF >> (7 - last % 8));
+        // a single byte of storage never takes the multi-byte path, checking STORAGE_BYTES lets the compiler see that
+        if (bitset_type::STORAGE_BYTES == 1 || first_byte == last_byte) {
+            bits_.data[first_byte] &= ~(first_mask & last_mask);
+            return;
+        }
+        bits_.data[first_byte] &= ~first_mask;
+        for (std::size_t i = first_byte + 1; i < last_byte; ++i)
+            bits_.data[i] = 0;
+        bits_.data[last_byte] &= ~last_mask;
+    }
+};
+
+} // namespace sb
+
+#endif
@@ -61,6 +61,9 @@ public:
 
     static_assert(num_bits > 0, "number of bits has to be greater than zero");
 
+    /// number of bytes actually used to store the bits
+    constexpr static std::size_t STORAGE_BYTES = NUM_BYTES;
+
     struct big_version {
         union {
             std::size_t register_size_arr[NUM_BYTES / REGISTER_BYTES];
@@ -147,14 +150,14 @@ public:
         }
     }
 
-    constexpr bool operator==(small_bitset other) const {
+    constexpr bool operator==(small_bitset const &other) const {
         for (std::size_t i = 0; i < NUM_BYTES; ++i)
             if (data[i] != other.data[i])
                 return false;
         return true;
     }
 
-    constexpr bool operator!=(small_bitset other) const {
+    constexpr bool operator!=(small_bitset const &other) const {
         return !(*this == other);
     }
 
@@ -397,6 +400,17 @@ public:
         return result;
     }
 
+    /// index of the lowest set bit, size() if no bit is set
+    std::size_t find_first() const {
+        return _find_from(0);
+    }
+
+    /// index of the lowest set bit after prev, size() if there is none
+    std::size_t find_next(std::size_t prev) const {
+        if (prev + 1 >= num_bits) return num_bits;
+        return _find_from(prev + 1);
+    }
+
 #if __cplusplus >= 202002l
     constexpr
 #endif
@@ -410,6 +424,37 @@ public:
     }
 
 private:
+    static std::size_t _lowest_bit(std::size_t x) {
+#if defined(__clang__) || defined(__GNUC__) || defined(__INTEL_COMPILER)
+        return __builtin_ctzll(x);
+#endif
+        std::size_t res = 0;
+        while (!(x & 1)) {
+            res += 1;
+            x >>= 1;
+        }
+        return res;
+    }
+
+    std::size_t _find_from(std::size_t idx) const {
+        std::size_t byte = idx / BITS_PER_BYTE;
+        std::uint8_t first = data[byte] & (0xFF << (idx % BITS_PER_BYTE));
+        if (first)
+            return byte * BITS_PER_BYTE + _lowest_bit(first);
+
+        // skip over empty regions a register at a time
+        for (++byte; byte + REGISTER_BYTES <= NUM_BYTES; byte += REGISTER_BYTES) {
+            std::size_t word;
+            std::memcpy(&word, data.begin() + byte, REGISTER_BYTES);
+            if (word)
+                return byte * BITS_PER_BYTE + _lowest_bit(word);
+        }
+        for (; byte < NUM_BYTES; ++byte)
+            if (data[byte])
+                return byte * BITS_PER_BYTE + _lowest_bit(data[byte]);
+        return num_bits;
+    }
+
     CXX17CONSTEXPR void _fix_last_byte() {
         data[NUM_BYTES - 1] &= LAST_BYTE_MASK;
     }
@@ -456,6 +501,11 @@ private:
     }
 };
 
+#if __cplusplus < 201703L
+template<std::size_t num_bits>
+constexpr std::size_t small_bitset<num_bits>::STORAGE_BYTES;
+#endif
+
 } // namespace sb
 
 #endif
\ No newline at end of file
@@ -0,0 +1,447 @@
+#ifndef SMALL_BITSET_KERNELS_H
+#define SMALL_BITSET_KERNELS_H
+
+#include "small_bitset.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+/*
+ * k-way kernels for combining many bitsets at once, e.g. posting lists of a bitmap index
+ * chaining operator|= once per operand streams the whole accumulator through memory k times,
+ * these kernels instead go through the bitsets one block of KERNEL_BLOCK_WORDS registers at a time
+ * and apply every operand to that block while it is still in L1, folding in four operands per pass over it
+ * the inner loops run over restrict qualified registers with a trip count known at compile time
+ * (for all but the last few registers), which is what gcc needs to vectorize them at -O2
+ */
+
+#if defined(__clang__) || defined(__GNUC__) || defined(__INTEL_COMPILER) || defined(_MSC_VER)
+#define SB_RESTRICT __restrict
+#else
+#define SB_RESTRICT
+#endif
+
+namespace sb {
+namespace detail {
+constexpr std::size_t KERNEL_BLOCK_WORDS = 512;
+constexpr std::size_t KERNEL_WORD_BYTES = sizeof(std::size_t);
+
+/// register sized view of the storage of a small_bitset, the last register may be partial
+template<std::size_t num_bits>
+struct kernel_words {
+    using bitset_type = small_bitset<num_bits>;
+
+    constexpr static std::size_t FULL_WORDS = bitset_type::STORAGE_BYTES / KERNEL_WORD_BYTES;
+    constexpr static std::size_t TAIL_BYTES = bitset_type::STORAGE_BYTES % KERNEL_WORD_BYTES;
+    constexpr static std::size_t NUM_WORDS = FULL_WORDS + (TAIL_BYTES != 0);
+
+    /// acc[i] = op(acc[i], word first + i of src) for i < n, returns the bitwise or of the new values
+    template<class F>
+    static std::size_t combine(bitset_type const &src, std::size_t first, std::size_t n, std::size_t *acc, F &&op) {
+        std::size_t const *regs = _registers(src, _has_registers{});
+        std::size_t full = first < FULL_WORDS ? std::min(n, FULL_WORDS - first) : 0;
+        std::size_t any = 0;
+        for (std::size_t i = 0; i < full; ++i) {
+            acc[i] = op(acc[i], regs[first + i]);
+            any |= acc[i];
+        }
+        if (full < n) {
+            std::size_t word = 0;
+            std::memcpy(&word, src.data.begin() + FULL_WORDS * KERNEL_WORD_BYTES, TAIL_BYTES);
+            acc[full] = op(acc[full], word);
+            any |= acc[full];
+        }
+        return any;
+    }
+
+    static void store(bitset_type &dst, std::size_t first, std::size_t n, std::size_t const *words) {
+        std::uint8_t *bytes = dst.data.begin() + first * KERNEL_WORD_BYTES;
+        std::size_t full = first < FULL_WORDS ? std::min(n, FULL_WORDS - first) : 0;
+        std::memcpy(bytes, words, full * KERNEL_WORD_BYTES);
+        if (full < n)
+            std::memcpy(bytes + full * KERNEL_WORD_BYTES, words + full, TAIL_BYTES);
+    }
+
+    /// clears the bits past num_bits, which operations like negation set
+    static void fix_last_byte(bitset_type &dst) {
+        if (num_bits % 8)
+            dst.data[bitset_type::STORAGE_BYTES - 1] &= 0xFF >> (8 - num_bits % 8);
+    }
+
+    /// the FULL_WORDS whole registers of the storage, nullptr if there are none
+    static std::size_t const *registers(bitset_type const &src) {
+        return _registers(src, _has_registers{});
+    }
+
+    static std::size_t *registers(bitset_type &dst) {
+        return const_cast<std::size_t *>(_registers(dst, _has_registers{}));
+    }
+
+private:
+    // only bitsets of at least one register have register_size_arr, smaller ones are handled as a tail
+    using _has_registers = std::integral_constant<bool, (FULL_WORDS > 0)>;
+
+    static std::size_t const *_registers(bitset_type const &src, std::true_type) {
+        return src.data.data.register_size_arr;
+    }
+
+    static std::size_t const *_registers(bitset_type const &, std::false_type) {
+        return nullptr;
+    }
+};
+
+/// calls kernel(first, n) over [0, num_words), n is an std::integral_constant for all but the last few registers
+/// so the loops of the kernel get a trip count the compiler knows
+template<class K>
+void for_each_block(std::size_t num_words, K &&kernel) {
+    std::size_t first = 0;
+    for (; first + KERNEL_BLOCK_WORDS <= num_words; first += KERNEL_BLOCK_WORDS)
+        kernel(first, std::integral_constant<std::size_t, KERNEL_BLOCK_WORDS>{});
+    for (; first + 8 <= num_words; first += 8)
+        kernel(first, std::integral_constant<std::size_t, 8>{});
+    if (first < num_words)
+        kernel(first, num_words - first);
+}
+
+/// dst = a | b | c | d, or dst |= a | b | c | d if not assign, repeating an operand is how fewer than four are passed
+template<class N>
+inline void or_group(std::size_t *SB_RESTRICT dst, std::size_t const *SB_RESTRICT a, std::size_t const *SB_RESTRICT b,
+                     std::size_t const *SB_RESTRICT c, std::size_t const *SB_RESTRICT d, bool assign, N n) {
+    if (assign) {
+        for (std::size_t i = 0; i < n; ++i)
+            dst[i] = a[i] | b[i] | c[i] | d[i];
+    } else {
+        for (std::size_t i = 0; i < n; ++i)
+            dst[i] |= a[i] | b[i] | c[i] | d[i];
+    }
+}
+
+/// dst = a & b & c & d, or dst &= a & b & c & d if not assign, repeating an operand is how fewer than four are passed
+/// returns whether any bit of dst is still set
+template<class N>
+inline bool and_group(std::size_t *SB_RESTRICT dst, std::size_t const *SB_RESTRICT a, std::size_t const *SB_RESTRICT b,
+                      std::size_t const *SB_RESTRICT c, std::size_t const *SB_RESTRICT d, bool assign, N n) {
+    std::size_t any = 0;
+    if (assign) {
+        for (std::size_t i = 0; i < n; ++i) {
+            dst[i] = a[i] & b[i] & c[i] & d[i];
+            any |= dst[i];
+        }
+    } else {
+        for (std::size_t i = 0; i < n; ++i) {
+            dst[i] &= a[i] & b[i] & c[i] & d[i];
+            any |= dst[i];
+        }
+    }
+    return any != 0;
+}
+
+/// number of bit slices needed to count up to max_count
+inline std::size_t counter_slices(std::size_t max_count) {
+    std::size_t slices = 0;
+    while (max_count) {
+        ++slices;
+        max_count >>= 1;
+    }
+    return slices;
+}
+
+/// adds src (one bit per lane) to the bit-sliced counters, slice j lives at slices + j * KERNEL_BLOCK_WORDS
+/// carry is scratch space for n registers
+template<class N>
+inline void counters_add(std::size_t *SB_RESTRICT slices, std::size_t num_slices, std::size_t const *SB_RESTRICT src, std::size_t *SB_RESTRICT carry, N n) {
+    std::size_t any = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        std::size_t in = src[i];
+        std::size_t next = slices[i] & in;
+        slices[i] ^= in;
+        carry[i] = next;
+        any |= next;
+    }
+    for (std::size_t j = 1; j < num_slices && any; ++j) {
+        std::size_t *SB_RESTRICT slice = slices + j * KERNEL_BLOCK_WORDS;
+        any = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            std::size_t next = slice[i] & carry[i];
+            slice[i] ^= carry[i];
+            carry[i] = next;
+            any |= next;
+        }
+    }
+}
+
+/// out gets the lanes whose counter is at least m, m has to fit in num_slices bits
+/// compares from the top slice down, equal is scratch space for n registers
+template<class N>
+inline void counters_at_least(std::size_t const *SB_RESTRICT slices, std::size_t num_slices, std::size_t m, std::size_t *SB_RESTRICT out, std::size_t *SB_RESTRICT equal, N n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        out[i] = 0;
+        equal[i] = static_cast<std::size_t>(-1);
+    }
+    for (std::size_t j = num_slices; j--;) {
+        std::size_t const *SB_RESTRICT slice = slices + j * KERNEL_BLOCK_WORDS;
+        if ((m >> j) & 1) {
+            for (std::size_t i = 0; i < n; ++i)
+                equal[i] &= slice[i];
+        } else {
+            for (std::size_t i = 0; i < n; ++i) {
+                out[i] |= equal[i] & slice[i];
+                equal[i] &= ~slice[i];
+            }
+        }
+    }
+    for (std::size_t i = 0; i < n; ++i)
+        out[i] |= equal[i];
+}
+} // namespace detail
+
+/// bitwise or of operands[0] ... operands[count - 1]
+template<std::size_t num_bits>
+small_bitset<num_bits> or_all(small_bitset<num_bits> const *const *operands, std::size_t count) {
+    using words = detail::kernel_words<num_bits>;
+    small_bitset<num_bits> result{};
+    if (count == 0) return result;
+
+    std::size_t *dst = words::registers(result);
+    detail::for_each_block(words::FULL_WORDS, [&](std::size_t first, auto n) {
+        for (std::size_t k = 0; k < count; k += 4) {
+            std::size_t last = std::min(k + 3, count - 1);
+            detail::or_group(dst + first, words::registers(*operands[k]) + first, words::registers(*operands[std::min(k + 1, last)]) + first,
+                             words::registers(*operands[std::min(k + 2, last)]) + first, words::registers(*operands[last]) + first, k == 0, n);
+        }
+    });
+    for (std::size_t i = words::FULL_WORDS * detail::KERNEL_WORD_BYTES; i < small_bitset<num_bits>::STORAGE_BYTES; ++i)
+        for (std::size_t k = 0; k < count; ++k)
+            result.data[i] |= operands[k]->data[i];
+    return result;
+}
+
+/// bitwise and of operands[0] ... operands[count - 1], all bits are set if count is zero
+/// a block stops reading further operands once it is zero, so putting the sparsest operands first pays off
+template<std::size_t num_bits>
+small_bitset<num_bits> and_all(small_bitset<num_bits> const *const *operands, std::size_t count) {
+    using words = detail::kernel_words<num_bits>;
+    small_bitset<num_bits> result{};
+    if (count == 0) return result.set();
+
+    std::size_t *dst = words::registers(result);
+    detail::for_each_block(words::FULL_WORDS, [&](std::size_t first, auto n) {
+        for (std::size_t k = 0; k < count; k += 4) {
+            std::size_t last = std::min(k + 3, count - 1);
+            if (!detail::and_group(dst + first, words::registers(*operands[k]) + first, words::registers(*operands[std::min(k + 1, last)]) + first,
+                                   words::registers(*operands[std::min(k + 2, last)]) + first, words::registers(*operands[last]) + first, k == 0, n))
+                break;
+        }
+    });
+    for (std::size_t i = words::FULL_WORDS * detail::KERNEL_WORD_BYTES; i < small_bitset<num_bits>::STORAGE_BYTES; ++i) {
+        result.data[i] = operands[0]->data[i];
+        for (std::size_t k = 1; k < count; ++k)
+            result.data[i] &= operands[k]->data[i];
+    }
+    return result;
+}
+
+/// bits which are set in at least m of operands[0] ... operands[count - 1]
+/// counts are kept in bit-sliced counters, so each operand costs a few register operations per register
+template<std::size_t num_bits>
+small_bitset<num_bits> at_least(std::size_t m, small_bitset<num_bits> const *const *operands, std::size_t count) {
+    using words = detail::kernel_words<num_bits>;
+    small_bitset<num_bits> result{};
+    if (m == 0) return result.set();
+    if (m > count) return result;
+    if (m == 1) return or_all(operands, count);
+    if (m == count) return and_all(operands, count);
+
+    std::size_t num_slices = detail::counter_slices(count);
+    std::vector<std::size_t> slices(num_slices * detail::KERNEL_BLOCK_WORDS);
+    std::vector<std::size_t> carry(detail::KERNEL_BLOCK_WORDS);
+    std::size_t *dst = words::registers(result);
+    detail::for_each_block(words::FULL_WORDS, [&](std::size_t first, auto n) {
+        std::fill(slices.begin(), slices.end(), 0);
+        for (std::size_t k = 0; k < count; ++k)
+            detail::counters_add(slices.data(), num_slices, words::registers(*operands[k]) + first, carry.data(), n);
+        detail::counters_at_least(slices.data(), num_slices, m, dst + first, carry.data(), n);
+    });
+    if (words::TAIL_BYTES) {
+        // the partial last register goes through the same counters, padding bits count zero votes so they stay clear
+        std::fill(slices.begin(), slices.end(), 0);
+        for (std::size_t k = 0; k < count; ++k) {
+            std::size_t word = 0;
+            words::combine(*operands[k], words::FULL_WORDS, 1, &word, [](std::size_t, std::size_t b) { return b; });
+            detail::counters_add(slices.data(), num_slices, &word, carry.data(), std::size_t{1});
+        }
+        std::size_t tail = 0;
+        detail::counters_at_least(slices.data(), num_slices, m, &tail, carry.data(), std::size_t{1});
+        words::store(result, words::FULL_WORDS, 1, &tail);
+    }
+    return result;
+}
+
+/// small boolean expression over operand bitsets, evaluated one block at a time
+/// nodes are created bottom up and referred to by the id the builder functions return:
+///     sb::query_plan<65536> plan;
+///     auto q = plan.all_of({plan.operand(0), plan.negate(plan.any_of({plan.operand(1), plan.operand(2)}))});
+///     auto hits = plan.evaluate(q, operands, 3);
+template<std::size_t num_bits>
+class query_plan {
+public:
+    using bitset_type = small_bitset<num_bits>;
+    using node_id = std::size_t;
+
+private:
+    using words = detail::kernel_words<num_bits>;
+
+    enum class node_kind {
+        operand,
+        all_of,
+        any_of,
+        at_least,
+        negate,
+    };
+
+    struct node {
+        node_kind kind;
+        std::size_t value; // operand index or threshold
+        std::size_t first_child;
+        std::size_t num_children;
+        std::size_t depth;
+    };
+
+    std::vector<node> nodes_;
+    std::vector<node_id> children_;
+
+public:
+    node_id operand(std::size_t index) {
+        return _add(node_kind::operand, index, {});
+    }
+
+    node_id all_of(std::vector<node_id> const &children) {
+        return _add(node_kind::all_of, 0, children);
+    }
+
+    node_id any_of(std::vector<node_id> const &children) {
+        return _add(node_kind::any_of, 0, children);
+    }
+
+    node_id at_least(std::size_t m, std::vector<node_id> const &children) {
+        return _add(node_kind::at_least, m, children);
+    }
+
+    node_id negate(node_id child) {
+        return _add(node_kind::negate, 0, {child});
+    }
+
+    bitset_type evaluate(node_id root, bitset_type const *const *operands, std::size_t count) const {
+        assert(root < nodes_.size() && "unknown node");
+        std::size_t levels = nodes_[root].depth + 1;
+        std::size_t num_slices = 0;
+        for (auto const &n: nodes_)
+            if (n.kind == node_kind::at_least)
+                num_slices = std::max(num_slices, detail::counter_slices(n.num_children));
+
+        // every level of the tree gets room for one child result and the counters of an at_least node
+        std::size_t level_words = (1 + num_slices) * detail::KERNEL_BLOCK_WORDS;
+        std::vector<std::size_t> scratch(levels * level_words);
+        std::size_t out[detail::KERNEL_BLOCK_WORDS] = {};
+
+        bitset_type result{};
+        for (std::size_t first = 0; first < words::NUM_WORDS; first += detail::KERNEL_BLOCK_WORDS) {
+            std::size_t n = std::min(detail::KERNEL_BLOCK_WORDS, words::NUM_WORDS - first);
+            _eval(root, operands, count, first, n, out, scratch.data(), level_words);
+            words::store(result, first, n, out);
+        }
+        words::fix_last_byte(result);
+        return result;
+    }
+
+private:
+    node_id _add(node_kind kind, std::size_t value, std::vector<node_id> const &children) {
+        std::size_t depth = 0;
+        for (node_id child: children) {
+            assert(child < nodes_.size() && "children have to be created before their parent");
+            depth = std::max(depth, nodes_[child].depth + 1);
+        }
+        nodes_.push_back({kind, value, children_.size(), children.size(), depth});
+        children_.insert(children_.end(), children.begin(), children.end());
+        return nodes_.size() - 1;
+    }
+
+    /// writes the value of the child into out, operands are combined straight from the bitsets
+    template<class F>
+    std::size_t _combine_child(node_id child, bitset_type const *const *operands, std::size_t count, std::size_t first, std::size_t n, std::size_t *out, std::size_t *scratch, std::size_t level_words, F &&op) const {
+        node const &c = nodes_[child];
+        if (c.kind == node_kind::operand) {
+            assert(c.value < count && "operand index out of range");
+            return words::combine(*operands[c.value], first, n, out, op);
+        }
+        std::size_t *value = scratch;
+        _eval(child, operands, count, first, n, value, scratch + level_words, level_words);
+        std::size_t any = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            out[i] = op(out[i], value[i]);
+            any |= out[i];
+        }
+        return any;
+    }
+
+    void _eval(node_id id, bitset_type const *const *operands, std::size_t count, std::size_t first, std::size_t n, std::size_t *out, std::size_t *scratch, std::size_t level_words) const {
+        node const &nd = nodes_[id];
+        node_id const *children = children_.data() + nd.first_child;
+        auto take = [](std::size_t, std::size_t b) { return b; };
+        switch (nd.kind) {
+            case node_kind::operand: {
+                _combine_child(id, operands, count, first, n, out, scratch, level_words, take);
+            } break;
+            case node_kind::all_of: {
+                std::fill(out, out + n, static_cast<std::size_t>(-1));
+                for (std::size_t k = 0; k < nd.num_children; ++k)
+                    if (!_combine_child(children[k], operands, count, first, n, out, scratch, level_words, [](std::size_t a, std::size_t b) { return a & b; }))
+                        break;
+            } break;
+            case node_kind::any_of: {
+                std::fill(out, out + n, 0);
+                for (std::size_t k = 0; k < nd.num_children; ++k)
+                    _combine_child(children[k], operands, count, first, n, out, scratch, level_words, [](std::size_t a, std::size_t b) { return a | b; });
+            } break;
+            case node_kind::at_least: {
+                if (nd.value > nd.num_children) {
+                    std::fill(out, out + n, 0);
+                    break;
+                }
+                std::size_t num_slices = detail::counter_slices(nd.num_children);
+                std::size_t *slices = scratch + detail::KERNEL_BLOCK_WORDS;
+                std::fill(slices, slices + num_slices * detail::KERNEL_BLOCK_WORDS, 0);
+                for (std::size_t k = 0; k < nd.num_children; ++k) {
+                    _combine_child(children[k], operands, count, first, n, out, scratch, level_words, take);
+                    // the child buffer of this level is free again once the child is in out
+                    detail::counters_add(slices, num_slices, out, scratch, n);
+                }
+                detail::counters_at_least(slices, num_slices, nd.value, out, scratch, n);
+            } break;
+            case node_kind::negate: {
+                _combine_child(children[0], operands, count, first, n, out, scratch, level_words, take);
+                for (std::size_t i = 0; i < n; ++i)
+                    out[i] = ~out[i];
+            } break;
+        }
+    }
+};
+
+#if __cplusplus < 201703L
+template<std::size_t num_bits>
+constexpr std::size_t detail::kernel_words<num_bits>::FULL_WORDS;
+
+template<std::size_t num_bits>
+constexpr std::size_t detail::kernel_words<num_bits>::TAIL_BYTES;
+
+template<std::size_t num_bits>
+constexpr std::size_t detail::kernel_words<num_bits>::NUM_WORDS;
+#endif
+
+} // namespace sb
+
+#endif
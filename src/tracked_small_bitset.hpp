@@ -0,0 +1,367 @@
+#ifndef TRACKED_SMALL_BITSET_H
+#define TRACKED_SMALL_BITSET_H
+
+#include "small_bitset.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace sb {
+/// small_bitset that remembers which parts of its storage changed
+/// the storage is split into chunks of chunk_bytes bytes and every mutator marks the chunks it touches,
+/// so take_delta() only has to look at (and copy) what changed since the last call
+/// snapshot() is O(1), afterwards the first write to a chunk copies that chunk (and only that one) into the snapshot
+template<std::size_t num_bits, std::size_t chunk_bytes = 64>
+class tracked_small_bitset {
+public:
+    using bitset_type = small_bitset<num_bits>;
+
+    static_assert(chunk_bytes > 0, "chunk size has to be greater than zero");
+
+    constexpr static std::size_t CHUNK_BYTES = chunk_bytes;
+    constexpr static std::size_t NUM_CHUNKS = (bitset_type::STORAGE_BYTES + chunk_bytes - 1) / chunk_bytes;
+
+
+    /// changed byte ranges of the storage together with their new contents
+    struct delta {
+        struct range {
+            std::size_t offset; // in bytes
+            std::size_t length; // in bytes
+        };
+
+        std::vector<range> ranges;
+        std::vector<std::uint8_t> bytes; // contents of all ranges back to back
+
+        bool empty() const {
+            return ranges.empty();
+        }
+
+        void apply_to(bitset_type &target) const {
+            std::size_t pos = 0;
+            for (auto const &r: ranges) {
+                assert(r.offset + r.length <= bitset_type::STORAGE_BYTES && "delta does not fit in bitset");
+                std::memcpy(target.data.begin() + r.offset, bytes.data() + pos, r.length);
+                pos += r.length;
+            }
+        }
+    };
+
+private:
+    /// the chunks the tracked bitset overwrote after the snapshot was taken, the others are read from the next
+    /// newer snapshot or, for the newest one, from the storage of the tracked bitset
+    struct _snapshot_state {
+        std::shared_ptr<bitset_type const> live;
+        std::shared_ptr<_snapshot_state> newer;
+        small_bitset<NUM_CHUNKS> saved{};
+        std::unique_ptr<std::uint8_t[]> old_bytes; // saved chunks at their offset in the storage, allocated on the first save
+
+        explicit _snapshot_state(std::shared_ptr<bitset_type const> bits) : live{std::move(bits)} {}
+
+        void save(std::size_t chunk) {
+            if (!old_bytes)
+                old_bytes.reset(new std::uint8_t[bitset_type::STORAGE_BYTES]);
+            std::size_t offset = chunk * chunk_bytes;
+            std::memcpy(old_bytes.get() + offset, live->data.begin() + offset, _chunk_length(chunk));
+            saved.set(chunk);
+        }
+    };
+
+public:
+    /// immutable view of the bits at the time snapshot() was called
+    class snapshot_type {
+        std::shared_ptr<_snapshot_state const> state_;
+
+    public:
+        explicit snapshot_type(std::shared_ptr<_snapshot_state const> state) : state_{std::move(state)} {}
+
+        bool operator[](std::size_t idx) const {
+            return test(idx);
+        }
+
+        bool test(std::size_t idx) const {
+            std::size_t chunk = idx / 8 / chunk_bytes;
+            for (_snapshot_state const *s = state_.get(); s; s = s->newer.get())
+                if (s->saved.test(chunk))
+                    return (s->old_bytes[idx / 8] >> (idx % 8)) & 1;
+            return state_->live->test(idx);
+        }
+
+        constexpr std::size_t size() const {
+            return num_bits;
+        }
+
+        /// copies the bits out, O(size())
+        bitset_type to_bitset() const {
+            std::vector<_snapshot_state const *> chain;
+            for (_snapshot_state const *s = state_.get(); s; s = s->newer.get())
+                chain.push_back(s);
+            bitset_type result = *state_->live;
+            // older snapshots saved the chunk before newer ones, so their copy wins
+            for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+                for (std::size_t chunk = (*it)->saved.find_first(); chunk < NUM_CHUNKS; chunk = (*it)->saved.find_next(chunk))
+                    std::memcpy(result.data.begin() + chunk * chunk_bytes, (*it)->old_bytes.get() + chunk * chunk_bytes, _chunk_length(chunk));
+            return result;
+        }
+    };
+
+private:
+    std::shared_ptr<bitset_type> bits_;
+    small_bitset<NUM_CHUNKS> dirty_{};
+    // snapshot() does not change the bits, the bookkeeping for it is mutable
+    mutable small_bitset<NUM_CHUNKS> shared_{}; // chunks the newest snapshot still reads from bits_
+    mutable std::weak_ptr<_snapshot_state> newest_;
+
+public:
+    tracked_small_bitset() : bits_{std::make_shared<bitset_type>()} {}
+
+    explicit tracked_small_bitset(bitset_type const &initial) : bits_{std::make_shared<bitset_type>(initial)} {}
+
+    /// copies the bits and the dirty chunks, snapshots of other are not shared
+    tracked_small_bitset(tracked_small_bitset const &other) : bits_{std::make_shared<bitset_type>(*other.bits_)}, dirty_{other.dirty_} {}
+
+    tracked_small_bitset &operator=(tracked_small_bitset const &other) {
+        if (this != &other) {
+            // snapshots of this keep reading the old storage, which is not written anymore
+            bits_ = std::make_shared<bitset_type>(*other.bits_);
+            dirty_ = other.dirty_;
+            shared_.reset();
+            newest_.reset();
+        }
+        return *this;
+    }
+
+    /// the current bits, the reference stays valid but sees every later mutation
+    /// take a snapshot() for a view that does not change
+    bitset_type const &bits() const {
+        return *bits_;
+    }
+
+    snapshot_type snapshot() const {
+        auto state = std::make_shared<_snapshot_state>(bits_);
+        if (auto previous = newest_.lock())
+            previous->newer = state;
+        newest_ = state;
+        shared_.set();
+        return snapshot_type{state};
+    }
+
+    /// chunks modified since the last take_delta() / clear_dirty()
+    small_bitset<NUM_CHUNKS> const &dirty() const {
+        return dirty_;
+    }
+
+    void clear_dirty() {
+        dirty_.reset();
+    }
+
+    bool operator==(tracked_small_bitset const &other) const {
+        return bits_ == other.bits_ || *bits_ == *other.bits_;
+    }
+
+    bool operator!=(tracked_small_bitset const &other) const {
+        return !(*this == other);
+    }
+
+    bool operator==(bitset_type const &other) const {
+        return *bits_ == other;
+    }
+
+    bool operator!=(bitset_type const &other) const {
+        return !(*this == other);
+    }
+
+    bool operator[](std::size_t idx) const {
+        return bits_->test(idx);
+    }
+
+    bool test(std::size_t idx) const {
+        return bits_->test(idx);
+    }
+
+    bool all() const {
+        return bits_->all();
+    }
+
+    bool any() const {
+        return bits_->any();
+    }
+
+    bool none() const {
+        return bits_->none();
+    }
+
+    std::size_t count() const {
+        return bits_->count();
+    }
+
+    constexpr std::size_t size() const {
+        return num_bits;
+    }
+
+    tracked_small_bitset &set(std::size_t idx) {
+        _unshare(idx / 8 / chunk_bytes);
+        bits_->set(idx);
+        _mark_bit(idx);
+        return *this;
+    }
+
+    tracked_small_bitset &reset(std::size_t idx) {
+        _unshare(idx / 8 / chunk_bytes);
+        bits_->reset(idx);
+        _mark_bit(idx);
+        return *this;
+    }
+
+    tracked_small_bitset &set(std::size_t idx, bool value) {
+        _unshare(idx / 8 / chunk_bytes);
+        bits_->set(idx, value);
+        _mark_bit(idx);
+        return *this;
+    }
+
+    tracked_small_bitset &set() {
+        _unshare_all();
+        bits_->set();
+        dirty_.set();
+        return *this;
+    }
+
+    tracked_small_bitset &reset() {
+        _unshare_all();
+        bits_->reset();
+        dirty_.set();
+        return *this;
+    }
+
+    tracked_small_bitset &flip() {
+        _unshare_all();
+        bits_->flip();
+        dirty_.set();
+        return *this;
+    }
+
+    tracked_small_bitset &operator&=(bitset_type const &other) {
+        _combine(other, [](std::uint8_t a, std::uint8_t b) { return static_cast<std::uint8_t>(a & b); });
+        return *this;
+    }
+
+    tracked_small_bitset &operator|=(bitset_type const &other) {
+        _combine(other, [](std::uint8_t a, std::uint8_t b) { return static_cast<std::uint8_t>(a | b); });
+        return *this;
+    }
+
+    tracked_small_bitset &operator^=(bitset_type const &other) {
+        _combine(other, [](std::uint8_t a, std::uint8_t b) { return static_cast<std::uint8_t>(a ^ b); });
+        return *this;
+    }
+
+    tracked_small_bitset &operator<<=(std::size_t amount) {
+        _unshare_all();
+        *bits_ <<= amount;
+        dirty_.set();
+        return *this;
+    }
+
+    tracked_small_bitset &operator>>=(std::size_t amount) {
+        _unshare_all();
+        *bits_ >>= amount;
+        dirty_.set();
+        return *this;
+    }
+
+    /// collects the contents of all dirty chunks, adjacent chunks are merged into one range
+    /// the dirty bitmap is cleared afterwards
+    delta take_delta() {
+        delta result;
+        // clean regions are skipped a register at a time
+        for (std::size_t chunk = dirty_.find_first(); chunk < NUM_CHUNKS; ) {
+            std::size_t last = chunk;
+            while (last + 1 < NUM_CHUNKS && dirty_.test(last + 1))
+                ++last;
+
+            std::size_t offset = chunk * chunk_bytes;
+            std::size_t length = std::min((last + 1) * chunk_bytes, bitset_type::STORAGE_BYTES) - offset;
+            result.ranges.push_back({offset, length});
+            result.bytes.insert(result.bytes.end(), bits_->data.begin() + offset, bits_->data.begin() + offset + length);
+            chunk = dirty_.find_next(last);
+        }
+        dirty_.reset();
+        return result;
+    }
+
+    /// applies a delta produced by another tracked_small_bitset of the same size
+    /// the touched chunks become dirty so the change can be forwarded further
+    tracked_small_bitset &apply(delta const &d) {
+        if (d.empty()) return *this;
+        for (auto const &r: d.ranges)
+            for (std::size_t chunk = r.offset / chunk_bytes; chunk * chunk_bytes < r.offset + r.length; ++chunk) {
+                _unshare(chunk);
+                dirty_.set(chunk);
+            }
+        d.apply_to(*bits_);
+        return *this;
+    }
+
+private:
+    static std::size_t _chunk_length(std::size_t chunk) {
+        return std::min(chunk_bytes, bitset_type::STORAGE_BYTES - chunk * chunk_bytes);
+    }
+
+    /// has to be called before chunk is written, hands its current contents to the newest snapshot if it still reads them
+    void _unshare(std::size_t chunk) {
+        if (!shared_.test(chunk)) return;
+        if (auto newest = newest_.lock()) {
+            newest->save(chunk);
+            shared_.reset(chunk);
+        } else {
+            shared_.reset();
+        }
+    }
+
+    void _unshare_all() {
+        if (shared_.none()) return;
+        if (auto newest = newest_.lock())
+            for (std::size_t chunk = shared_.find_first(); chunk < NUM_CHUNKS; chunk = shared_.find_next(chunk))
+                newest->save(chunk);
+        shared_.reset();
+    }
+
+    void _mark_bit(std::size_t idx) {
+        dirty_.set(idx / 8 / chunk_bytes);
+    }
+
+    /// only chunks which actually change are unshared and marked dirty
+    template<class F>
+    void _combine(bitset_type const &other, F &&op) {
+        std::uint8_t *self = bits_->data.begin();
+        std::uint8_t const *rhs = other.data.begin();
+        for (std::size_t chunk = 0; chunk < NUM_CHUNKS; ++chunk) {
+            std::size_t begin = chunk * chunk_bytes;
+            std::size_t end = begin + _chunk_length(chunk);
+            std::uint8_t changed = 0;
+            for (std::size_t i = begin; i < end; ++i)
+                changed |= self[i] ^ op(self[i], rhs[i]);
+            if (!changed) continue;
+            _unshare(chunk);
+            dirty_.set(chunk);
+            for (std::size_t i = begin; i < end; ++i)
+                self[i] = op(self[i], rhs[i]);
+        }
+    }
+};
+
+#if __cplusplus < 201703L
+template<std::size_t num_bits, std::size_t chunk_bytes>
+constexpr std::size_t tracked_small_bitset<num_bits, chunk_bytes>::CHUNK_BYTES;
+
+template<std::size_t num_bits, std::size_t chunk_bytes>
+constexpr std::size_t tracked_small_bitset<num_bits, chunk_bytes>::NUM_CHUNKS;
+#endif
+
+} // namespace sb
+
+#endif
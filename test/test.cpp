@@ -1,4 +1,8 @@
+#include "../src/bit_parallel_matcher.hpp"
 #include "../src/small_bitset.hpp"
+#include "../src/ring_small_bitset.hpp"
+#include "../src/small_bitset_kernels.hpp"
+#include "../src/tracked_small_bitset.hpp"
 #include <array>
 #include <atomic>
 #include <bitset>
@@ -129,6 +133,300 @@ void test() {
     }
 }
 
+template<int size, std::size_t chunk_bytes>
+void test_tracked() {
+    std::mt19937_64 mt{std::random_device{}()};
+
+    using udi = std::uniform_int_distribution<int>;
+
+    sb::tracked_small_bitset<size, chunk_bytes> tracked{};
+    sb::small_bitset<size> replica{};
+    sb::small_bitset<size> expected{};
+    // outlives many newer snapshots, so its unsaved chunks are read through them
+    auto held = tracked.snapshot();
+    auto held_bits = expected;
+
+    for (int _ = 0; _ < (1 << 16); ++_) {
+        auto chosen = udi{0, 9}(mt);
+        int i = udi{0, size - 1}(mt);
+        auto snapshot = tracked.snapshot();
+        auto before = snapshot.to_bitset();
+        switch (chosen) {
+            case 0: {
+                tracked.set(i);
+                expected.set(i);
+            } break;
+            case 1: {
+                tracked.reset(i);
+                expected.reset(i);
+            } break;
+            case 2: {
+                tracked.set(i, !tracked[i]);
+                expected.set(i, !expected[i]);
+            } break;
+            case 3: {
+                tracked.flip();
+                expected.flip();
+            } break;
+            case 4: {
+                tracked.reset();
+                expected.reset();
+            } break;
+            case 5: {
+                tracked |= expected >> i;
+                expected |= expected >> i;
+            } break;
+            case 6: {
+                tracked ^= expected << i;
+                expected ^= expected << i;
+            } break;
+            case 7: {
+                tracked &= expected >> i;
+                expected &= expected >> i;
+            } break;
+            case 8: {
+                tracked <<= i;
+                expected <<= i;
+            } break;
+            case 9: {
+                auto delta = tracked.take_delta();
+                assert(tracked.dirty().none());
+                delta.apply_to(replica);
+                assert(replica == expected);
+            } break;
+            default: {
+            } break;
+        }
+        assert(tracked == expected);
+        assert(snapshot.to_bitset() == before);
+        assert(snapshot[i] == before[i]);
+        assert(held.to_bitset() == held_bits);
+        assert(held[i] == held_bits[i]);
+        if (_ % 64 == 0) {
+            held = tracked.snapshot();
+            held_bits = expected;
+        }
+        for (std::size_t chunk = 0; chunk < tracked.NUM_CHUNKS; ++chunk) {
+            std::size_t end = std::min((chunk + 1) * chunk_bytes, replica.STORAGE_BYTES);
+            if (!tracked.dirty()[chunk])
+                for (std::size_t b = chunk * chunk_bytes; b < end; ++b)
+                    assert(replica.data[b] == expected.data[b]);
+        }
+    }
+
+    sb::tracked_small_bitset<size, chunk_bytes> downstream{replica};
+    downstream.apply(tracked.take_delta());
+    assert(downstream == tracked);
+}
+
+template<int size>
+void test_ring() {
+    std::mt19937_64 mt{std::random_device{}()};
+
+    using udi = std::uniform_int_distribution<int>;
+
+    sb::ring_small_bitset<size> ring{};
+    sb::small_bitset<size> expected{};
+
+    auto first_from = [&](std::size_t idx) {
+        while (idx < expected.size() && !expected[idx])
+            ++idx;
+        return idx;
+    };
+
+    for (int _ = 0; _ < (1 << 16); ++_) {
+        auto chosen = udi{0, 8}(mt);
+        int i = udi{0, size - 1}(mt);
+        switch (chosen) {
+            case 0: {
+                ring.set(i);
+                expected.set(i);
+            } break;
+            case 1: {
+                ring.reset(i);
+                expected.reset(i);
+            } break;
+            case 2: {
+                ring.push(i & 1);
+                expected <<= 1;
+                expected.set(0, i & 1);
+            } break;
+            case 3: {
+                ring.advance(i);
+                expected <<= i;
+            } break;
+            case 4: {
+                ring.rotate_left(i);
+                expected = (expected << i) | (expected >> (size - i));
+            } break;
+            case 5: {
+                ring.rotate_right(i);
+                expected = (expected >> i) | (expected << (size - i));
+            } break;
+            case 6: {
+                ring.flip();
+                expected.flip();
+            } break;
+            case 7: {
+                ring = sb::ring_small_bitset<size>{ring.to_bitset()};
+            } break;
+            case 8: {
+                ring.advance(size + i);
+                expected.reset();
+            } break;
+            default: {
+            } break;
+        }
+        assert(ring.to_bitset() == expected);
+        assert(ring.to_string() == expected.to_string());
+        assert(ring.count() == expected.count());
+        assert(ring.any() == expected.any());
+        assert(ring.all() == expected.all());
+        assert(ring.find_first() == first_from(0));
+        assert(expected.find_first() == first_from(0));
+        assert(ring.find_next(i) == first_from(i + 1));
+        assert(expected.find_next(i) == first_from(i + 1));
+        for (std::size_t j = 0; j < ring.size(); ++j)
+            assert(ring[j] == expected[j]);
+    }
+}
+
+template<int size>
+void test_kernels() {
+    std::mt19937_64 mt{std::random_device{}()};
+
+    using udi = std::uniform_int_distribution<int>;
+    using bitset = sb::small_bitset<size>;
+
+    for (int _ = 0; _ < (1 << 8); ++_) {
+        std::vector<bitset> operands(udi{0, 12}(mt));
+        for (auto &op: operands) {
+            // about half the operands have 1-5% of their bits set, a few of those together clear whole blocks
+            // so and_all hits its early exit, the rest are 50-80% dense
+            int percent = udi{0, 1}(mt) ? udi{1, 5}(mt) : udi{50, 80}(mt);
+            for (std::size_t i = 0; i < op.size(); ++i)
+                op.set(i, udi{0, 99}(mt) < percent);
+        }
+        std::vector<bitset const *> ptrs;
+        for (auto const &op: operands)
+            ptrs.push_back(&op);
+
+        bitset expected_or{};
+        bitset expected_and = bitset{}.set();
+        for (auto const &op: operands) {
+            expected_or |= op;
+            expected_and &= op;
+        }
+        assert(sb::or_all(ptrs.data(), ptrs.size()) == expected_or);
+        assert(sb::and_all(ptrs.data(), ptrs.size()) == expected_and);
+
+        std::size_t m = udi{0, static_cast<int>(operands.size()) + 1}(mt);
+        auto at_least = sb::at_least(m, ptrs.data(), ptrs.size());
+        for (std::size_t i = 0; i < at_least.size(); ++i) {
+            std::size_t c = 0;
+            for (auto const &op: operands)
+                c += op[i];
+            assert(at_least[i] == (c >= m));
+        }
+
+        if (operands.size() < 7) continue;
+        sb::query_plan<size> plan;
+        auto op = [&](std::size_t i) { return plan.operand(i); };
+        auto root = plan.any_of({plan.all_of({op(0), plan.negate(plan.any_of({op(1), op(2)}))}),
+                                 plan.at_least(2, {op(3), op(4), op(5), plan.all_of({op(0), op(6)})})});
+        auto expected = (operands[0] & ~(operands[1] | operands[2]));
+        for (std::size_t i = 0; i < expected.size(); ++i) {
+            int votes = operands[3][i] + operands[4][i] + operands[5][i] + (operands[0][i] && operands[6][i]);
+            if (votes >= 2) expected.set(i);
+        }
+        auto evaluated = plan.evaluate(root, ptrs.data(), ptrs.size());
+        assert(evaluated == expected);
+        assert(plan.evaluate(plan.negate(root), ptrs.data(), ptrs.size()) == ~expected);
+    }
+}
+
+template<std::size_t max_pattern_length>
+void test_matchers() {
+    std::mt19937_64 mt{std::random_device{}()};
+
+    using udi = std::uniform_int_distribution<int>;
+
+    for (int _ = 0; _ < (1 << 4); ++_) {
+        std::size_t alphabet = udi{1, 4}(mt);
+        auto random_string = [&](std::size_t length) {
+            std::string res;
+            for (std::size_t i = 0; i < length; ++i)
+                res.push_back(static_cast<char>('a' + udi{0, static_cast<int>(alphabet) - 1}(mt)));
+            return res;
+        };
+        // the first round checks the empty pattern, which matches everywhere
+        std::string pattern = random_string(_ == 0 ? 0 : udi{1, max_pattern_length}(mt));
+        std::string text = random_string(udi{0, 3000}(mt));
+        // plant a few slightly modified copies of the pattern
+        for (int copies = pattern.empty() ? 0 : udi{0, 3}(mt); copies--;) {
+            std::string copy = pattern;
+            copy[udi{0, static_cast<int>(copy.size()) - 1}(mt)] = 'z';
+            text.insert(udi{0, static_cast<int>(text.size())}(mt), copy);
+        }
+        std::size_t max_errors = udi{0, 4}(mt);
+
+        // distance[j] is the edit distance between the pattern and the best substring ending before text[j]
+        std::vector<std::size_t> column(pattern.size() + 1);
+        std::vector<std::size_t> distance;
+        for (std::size_t i = 0; i <= pattern.size(); ++i)
+            column[i] = i;
+        for (char c: text) {
+            std::size_t diagonal = column[0];
+            for (std::size_t i = 1; i <= pattern.size(); ++i) {
+                std::size_t next = std::min({column[i] + 1, column[i - 1] + 1, diagonal + (pattern[i - 1] != c)});
+                diagonal = column[i];
+                column[i] = next;
+            }
+            distance.push_back(column[pattern.size()]);
+        }
+
+        std::vector<std::size_t> expected;
+        for (std::size_t j = 0; j < distance.size(); ++j)
+            if (distance[j] <= max_errors)
+                expected.push_back(j + 1);
+
+        sb::shift_and_matcher<max_pattern_length> shift_and{pattern, max_errors};
+        std::vector<std::size_t> found;
+        shift_and.scan(text, [&](std::size_t end) { found.push_back(end); });
+        assert(found == expected);
+
+        sb::myers_matcher<max_pattern_length> myers{pattern, max_errors};
+        found.clear();
+        myers.scan(text, [&](std::size_t end, std::size_t d) {
+            assert(d == distance[end - 1]);
+            found.push_back(end);
+        });
+        assert(found == expected);
+
+        // stepping through the text gives the same result
+        myers.reset();
+        for (std::size_t j = 0; j < text.size(); ++j) {
+            assert(myers.step(static_cast<unsigned char>(text[j])) == (distance[j] <= max_errors));
+            assert(distance[j] <= max_errors ? myers.distance() == distance[j] : myers.distance() > max_errors);
+        }
+
+        sb::shift_and_matcher<max_pattern_length> exact{pattern};
+        exact.scan(text.data(), text.size() / 2, [](std::size_t) {});
+        exact.scan(text.data() + text.size() / 2, text.size() - text.size() / 2, [](std::size_t) {});
+        if (!pattern.empty() && text.size() >= pattern.size())
+            assert(exact.active_prefixes()[pattern.size() - 1] == (text.compare(text.size() - pattern.size(), pattern.size(), pattern) == 0));
+
+        std::vector<sb::myers_matcher<max_pattern_length>> batch;
+        batch.emplace_back(pattern, max_errors);
+        batch.emplace_back(pattern, 0);
+        std::vector<std::size_t> batch_found[2];
+        sb::scan_batch(batch, text, [&](std::size_t i, std::size_t end, std::size_t) { batch_found[i].push_back(end); });
+        assert(batch_found[0] == expected);
+        for (std::size_t end: batch_found[1])
+            assert(distance[end - 1] == 0);
+    }
+}
+
 int main() {
     std::vector<std::future<void>> futures;
 #define LAUNCH(x) futures.push_back(std::async(std::launch::async, [&]() { x; }))
@@ -261,6 +559,26 @@ int main() {
     LAUNCH(test<126>());
     LAUNCH(test<127>());
     LAUNCH(test<128>());
+    LAUNCH(test_matchers<1>());
+    LAUNCH(test_matchers<64>());
+    LAUNCH(test_matchers<65>());
+    LAUNCH(test_matchers<300>());
+    LAUNCH(test_matchers<1024>());
+    LAUNCH(test_ring<1>());
+    LAUNCH(test_ring<7>());
+    LAUNCH(test_ring<64>());
+    LAUNCH(test_ring<100>());
+    LAUNCH(test_ring<1031>());
+    LAUNCH(test_kernels<1>());
+    LAUNCH(test_kernels<13>());
+    LAUNCH(test_kernels<64>());
+    LAUNCH(test_kernels<1000>());
+    LAUNCH(test_kernels<65536 + 17>());
+    LAUNCH((test_tracked<1, 1>()));
+    LAUNCH((test_tracked<63, 1>()));
+    LAUNCH((test_tracked<100, 3>()));
+    LAUNCH((test_tracked<1000, 8>()));
+    LAUNCH((test_tracked<4099, 64>()));
     int done_count = 0;
     for (auto &&f: futures) {
         f.get();